@@ -11,6 +11,10 @@ CTDerivatives/ctdt2.hpp by Chris
 #include <tuple>
 #include <cmath>
 #include <numbers>
+#include <cstddef>
+#include <utility>
+#include <array>
+#include <span>
 
 // ------------------------------------------------------------------------------------------------
 // Basic Function Atoms
@@ -25,8 +29,13 @@ concept MathType = requires(T t1, T t2)
 }
 &&std::constructible_from<T, int>;
 
+// Every expression node has Type and a static function, requiring them keeps the operator overloads below away from unrelated types (iterators, paths, ...)
 template <class T>
-concept Expression = true;
+concept Expression = requires
+{
+    typename T::Type;
+    T::function;
+};
 
 // ---------------------------------------------- Constant Definition ----------------------------------------------
 
@@ -529,4 +538,377 @@ StartBinaryOperatorSimplification(Pow_impl)
     AddSimplification((std::same_as<SE1, Zero<T>>), Zero<T>)    // 0^y = 0
     AddSimplification((std::same_as<SE1, One<T>>), One<T>)      // 1^y = 1
 EndBinaryOperatorSimplification(Pow_impl);
+
+// ---------------------------------------------- Fused evaluation (forward mode) ----------------------------------------------
+
+/************************************************
+ * jet: Value, gradient and (if Hessian) hessian of a subexpression at one point, hess[i * NVars + j] = d/d(Var j) d/d(Var i)
+ * evaluate_jet: Walks the expression once and passes the jet of every node up to its parent, so every node
+ *               (including the std::sin, std::exp, ... calls) is evaluated once for value and all derivatives together
+ *               instead of evaluating f and every derivative<ID>(f) tree on its own
+ * jet_chain: g(u) from g(u.value), g'(u.value) and g''(u.value)
+ * GenerateBinaryOperatorJet / GenerateUnaryFunctionJet: evaluate_jet for a node type, the unary one takes g' and g''
+ *               as expressions in v (the argument value) and g (the function value)
+ ***********************************************/
+
+template <MathType T, std::size_t NVars, bool Hessian>
+struct jet
+{
+    T value;
+    std::array<T, NVars> grad;
+    std::array<T, Hessian ? NVars * NVars : 0> hess;
+};
+
+template <MathType T, std::size_t N, bool H>
+jet<T, N, H> jet_chain(const jet<T, N, H> &u, T g, T d1, T d2)
+{
+    jet<T, N, H> r{};
+    r.value = g;
+    for (std::size_t i = 0; i < N; ++i)
+        r.grad[i] = d1 * u.grad[i];
+    if constexpr (H)
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                r.hess[i * N + j] = d1 * u.hess[i * N + j] + d2 * u.grad[i] * u.grad[j];
+    return r;
+}
+
+template <MathType T, std::size_t N, bool H>
+jet<T, N, H> jet_add(const jet<T, N, H> &a, const jet<T, N, H> &b)
+{
+    jet<T, N, H> r{};
+    r.value = a.value + b.value;
+    for (std::size_t i = 0; i < N; ++i)
+        r.grad[i] = a.grad[i] + b.grad[i];
+    for (std::size_t i = 0; i < r.hess.size(); ++i)
+        r.hess[i] = a.hess[i] + b.hess[i];
+    return r;
+}
+
+template <MathType T, std::size_t N, bool H>
+jet<T, N, H> jet_sub(const jet<T, N, H> &a, const jet<T, N, H> &b)
+{
+    jet<T, N, H> r{};
+    r.value = a.value - b.value;
+    for (std::size_t i = 0; i < N; ++i)
+        r.grad[i] = a.grad[i] - b.grad[i];
+    for (std::size_t i = 0; i < r.hess.size(); ++i)
+        r.hess[i] = a.hess[i] - b.hess[i];
+    return r;
+}
+
+template <MathType T, std::size_t N, bool H>
+jet<T, N, H> jet_mul(const jet<T, N, H> &a, const jet<T, N, H> &b)
+{
+    jet<T, N, H> r{};
+    r.value = a.value * b.value;
+    for (std::size_t i = 0; i < N; ++i)
+        r.grad[i] = a.grad[i] * b.value + a.value * b.grad[i];
+    if constexpr (H)
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                r.hess[i * N + j] = a.hess[i * N + j] * b.value + a.value * b.hess[i * N + j] + a.grad[i] * b.grad[j] + b.grad[i] * a.grad[j];
+    return r;
+}
+
+template <MathType T, std::size_t N, bool H>
+jet<T, N, H> jet_div(const jet<T, N, H> &a, const jet<T, N, H> &b)
+{
+    const T inv = T{1} / b.value;
+    auto r = jet_mul(a, jet_chain(b, inv, -inv * inv, T{2} * inv * inv * inv)); // a * (1 / b)
+    r.value = a.value / b.value;
+    return r;
+}
+
+template <std::size_t NVars, bool H, MathType T, T Val>
+jet<T, NVars, H> evaluate_jet(Constant<T, Val>, const T *)
+{
+    jet<T, NVars, H> r{};
+    r.value = Val;
+    return r;
+}
+
+template <std::size_t NVars, bool H, MathType T, std::size_t Var, char Repr>
+jet<T, NVars, H> evaluate_jet(Variable<T, Var, Repr>, const T *vars)
+{
+    static_assert(Var < NVars, "the expression uses a variable ID >= NVars");
+    jet<T, NVars, H> r{};
+    r.value = vars[Var];
+    r.grad[Var] = T{1};
+    return r;
+}
+
+#define GenerateBinaryOperatorJet(name, combine)                                                                        \
+    template <std::size_t NVars, bool H, MathType T, Expression E1, Expression E2>                                      \
+    jet<T, NVars, H> evaluate_jet(name<T, E1, E2>, const T *vars)                                                       \
+    {                                                                                                                   \
+        using E = name<T, E1, E2>;                                                                                      \
+        return combine(evaluate_jet<NVars, H>(typename E::SE1{}, vars), evaluate_jet<NVars, H>(typename E::SE2{}, vars)); \
+    }
+
+GenerateBinaryOperatorJet(Add, jet_add);
+GenerateBinaryOperatorJet(Sub, jet_sub);
+GenerateBinaryOperatorJet(Mul, jet_mul);
+GenerateBinaryOperatorJet(Div, jet_div);
+
+template <std::size_t NVars, bool H, MathType T, Expression E1>
+jet<T, NVars, H> evaluate_jet(UnaryMinus<T, E1>, const T *vars)
+{
+    const auto u = evaluate_jet<NVars, H>(typename UnaryMinus<T, E1>::SE1{}, vars);
+    return jet_chain(u, -u.value, T{-1}, T{0});
+}
+
+#define GenerateUnaryFunctionJet(name, func, d1, d2)                                        \
+    template <std::size_t NVars, bool H, MathType T, Expression E1>                         \
+    jet<T, NVars, H> evaluate_jet(name##_impl<T, E1>, const T *vars)                        \
+    {                                                                                       \
+        const auto u = evaluate_jet<NVars, H>(typename name##_impl<T, E1>::SE1{}, vars);    \
+        const T v = u.value;                                                                \
+        const T g = func(v);                                                                \
+        return jet_chain(u, g, static_cast<T>(d1), static_cast<T>(d2));                     \
+    }
+
+GenerateUnaryFunctionJet(Sin, std::sin, std::cos(v), -g);
+GenerateUnaryFunctionJet(Cos, std::cos, -std::sin(v), -g);
+GenerateUnaryFunctionJet(Tan, std::tan, T{1} + g * g, T{2} * g * (T{1} + g * g));
+GenerateUnaryFunctionJet(Exp, std::exp, g, g);
+GenerateUnaryFunctionJet(Ln, std::log, T{1} / v, T{-1} / (v * v));
+GenerateUnaryFunctionJet(Sqrt, std::sqrt, T{1} / (T{2} * g), T{-1} / (T{4} * g * v));
+GenerateUnaryFunctionJet(Cbrt, std::cbrt, T{1} / (T{3} * g * g), T{-2} / (T{9} * g * g * v));
+GenerateUnaryFunctionJet(Sinh, std::sinh, std::cosh(v), g);
+GenerateUnaryFunctionJet(Cosh, std::cosh, std::sinh(v), g);
+GenerateUnaryFunctionJet(Tanh, std::tanh, T{1} - g * g, T{-2} * g * (T{1} - g * g));
+
+template <std::size_t NVars, bool H, MathType T, Expression E1, Expression E2>
+jet<T, NVars, H> evaluate_jet(Pow_impl<T, E1, E2>, const T *vars)
+{
+    using E = Pow_impl<T, E1, E2>;
+    const auto a = evaluate_jet<NVars, H>(typename E::SE1{}, vars);
+    if constexpr (is_constant<typename E::SE2>)
+    {
+        // u^c, the common case and also fine for u <= 0
+        const T c = E::SE2::function();
+        T d2{0};
+        if constexpr (H)
+            d2 = c * (c - T{1}) * std::pow(a.value, c - T{2});
+        return jet_chain(a, std::pow(a.value, c), c * std::pow(a.value, c - T{1}), d2);
+    }
+    else
+    {
+        // u^w = exp(w * ln(u))
+        const auto b = evaluate_jet<NVars, H>(typename E::SE2{}, vars);
+        const auto ln_a = jet_chain(a, std::log(a.value), T{1} / a.value, T{-1} / (a.value * a.value));
+        const T g = std::pow(a.value, b.value);
+        return jet_chain(jet_mul(b, ln_a), g, g, g);
+    }
+}
+
+// ---------------------------------------------- Evaluation over argument arrays ----------------------------------------------
+// NVars is the number of variable IDs the caller provides, vars[ID] / columns[ID] is the value(s) for Variable<T, ID>
+
+template <std::size_t NVars, Expression E>
+auto evaluate(E, const typename E::Type *vars)
+{
+    return [&]<std::size_t... Is>(std::index_sequence<Is...>) { return E::function(vars[Is]...); }(std::make_index_sequence<NVars>{});
+}
+
+template <std::size_t NVars, Expression E>
+void evaluate_batch(E, const typename E::Type *const *columns, typename E::Type *out, std::size_t n)
+{
+    [&]<std::size_t... Is>(std::index_sequence<Is...>)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[i] = E::function(columns[Is][i]...);
+    }(std::make_index_sequence<NVars>{});
+}
+
+// grad[ID] = d/d(Var ID) of the expression
+template <std::size_t NVars, Expression E>
+void evaluate_gradient(E, const typename E::Type *vars, typename E::Type *grad)
+{
+    [&]<std::size_t... Is>(std::index_sequence<Is...>) { ((grad[Is] = evaluate<NVars>(derivative<Is>(E{}), vars)), ...); }(std::make_index_sequence<NVars>{});
+}
+
+template <std::size_t NVars, Expression E>
+void evaluate_gradient_batch(E, const typename E::Type *const *columns, typename E::Type *const *grads, std::size_t n)
+{
+    [&]<std::size_t... Is>(std::index_sequence<Is...>) { (evaluate_batch<NVars>(derivative<Is>(E{}), columns, grads[Is], n), ...); }(std::make_index_sequence<NVars>{});
+}
+
+// value and gradient (and hessian) from one evaluate_jet pass, every node of the expression is evaluated once
+template <std::size_t NVars, Expression E>
+auto evaluate_value_gradient(E, const typename E::Type *vars, typename E::Type *grad)
+{
+    const auto j = evaluate_jet<NVars, false>(E{}, vars);
+    for (std::size_t i = 0; i < NVars; ++i)
+        grad[i] = j.grad[i];
+    return j.value;
+}
+
+// hess[i * NVars + j] = d/d(Var j) d/d(Var i) of the expression
+template <std::size_t NVars, Expression E>
+auto evaluate_value_gradient_hessian(E, const typename E::Type *vars, typename E::Type *grad, typename E::Type *hess)
+{
+    const auto j = evaluate_jet<NVars, true>(E{}, vars);
+    for (std::size_t i = 0; i < NVars; ++i)
+        grad[i] = j.grad[i];
+    for (std::size_t i = 0; i < NVars * NVars; ++i)
+        hess[i] = j.hess[i];
+    return j.value;
+}
+
+// ---------------------------------------------- Separately compiled kernels ----------------------------------------------
+
+/************************************************
+ * DeclareCompiledKernel: Declares the extern entry points of a kernel, put this in a header
+ *                      name(vars)                                  -> value
+ *                      name##_batch(columns, out, n)               -> out[i] for every point i
+ *                      name##_gradient(vars, grad)                 -> grad[ID] for every variable ID
+ *                      name##_gradient_batch(columns, grads, n)    -> grads[ID][i]
+ * GenerateCompiledKernel: Defines these functions for the expression (last arg) with NVars variables, put this in exactly one TU
+ *                      the expression is only used inside decltype so the variables it names dont need to be constexpr
+ * Only the TU with GenerateCompiledKernel instantiates the expression and its derivatives, every other TU just links against it
+ ***********************************************/
+
+#define DeclareCompiledKernel(name, T)                                                \
+    T name(const T *vars);                                                            \
+    void name##_batch(const T *const *columns, T *out, std::size_t n);                \
+    void name##_gradient(const T *vars, T *grad);                                     \
+    void name##_gradient_batch(const T *const *columns, T *const *grads, std::size_t n)
+
+#define GenerateCompiledKernel(name, NVars, ...)                                                                               \
+    using name##_expr = decltype(__VA_ARGS__);                                                                                 \
+    using name##_type = typename name##_expr::Type;                                                                            \
+    name##_type name(const name##_type *vars)                                                                                  \
+    {                                                                                                                          \
+        return evaluate<NVars>(name##_expr{}, vars);                                                                           \
+    }                                                                                                                          \
+    void name##_batch(const name##_type *const *columns, name##_type *out, std::size_t n)                                      \
+    {                                                                                                                          \
+        evaluate_batch<NVars>(name##_expr{}, columns, out, n);                                                                 \
+    }                                                                                                                          \
+    void name##_gradient(const name##_type *vars, name##_type *grad)                                                           \
+    {                                                                                                                          \
+        evaluate_gradient<NVars>(name##_expr{}, vars, grad);                                                                   \
+    }                                                                                                                          \
+    void name##_gradient_batch(const name##_type *const *columns, name##_type *const *grads, std::size_t n)                    \
+    {                                                                                                                          \
+        evaluate_gradient_batch<NVars>(name##_expr{}, columns, grads, n);                                                      \
+    }
+
+// ---------------------------------------------- Type erased function handle ----------------------------------------------
+
+/************************************************
+ * compiled_fn: Two function pointers (scalar and batch entry point) for an expression with NVars variables
+ *              Built from any expression or from the functions of a compiled kernel (model, model_batch), no allocation
+ * make_dispatch_table: {f, df/dVar0, ..., df/dVar(NVars-1)} as compiled_fn so it can be stored next to other models
+ * dispatch_batch: Runs every function of a table over the same columns, one indirect call per function and batch
+ ***********************************************/
+
+template <MathType T, std::size_t NVars>
+struct compiled_fn
+{
+    using Type = T;
+    static constexpr std::size_t arity = NVars;
+    using scalar_fn = T (*)(const T *);
+    using batch_fn = void (*)(const T *const *, T *, std::size_t);
+
+    scalar_fn scalar = nullptr;
+    batch_fn batch = nullptr;
+
+    constexpr compiled_fn() = default;
+    constexpr compiled_fn(scalar_fn s, batch_fn b) : scalar(s), batch(b) {}
+
+    template <Expression E>
+    requires std::same_as<typename E::Type, T>
+    constexpr compiled_fn(E)
+        : scalar([](const T *vars) -> T { return evaluate<NVars>(E{}, vars); }),
+          batch([](const T *const *columns, T *out, std::size_t n) { evaluate_batch<NVars>(E{}, columns, out, n); }) {}
+
+    template <std::convertible_to<T>... Ts>
+    requires(sizeof...(Ts) >= NVars)
+    T operator()(Ts... args) const
+    {
+        const std::array<T, sizeof...(Ts)> vars{static_cast<T>(args)...};
+        return scalar(vars.data());
+    }
+    T operator()(const T *vars) const { return scalar(vars); }
+    void operator()(const T *const *columns, T *out, std::size_t n) const { batch(columns, out, n); }
+};
+
+template <std::size_t NVars, Expression E>
+auto make_dispatch_table(E)
+{
+    using T = typename E::Type;
+    return [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+        return std::array<compiled_fn<T, NVars>, NVars + 1>{compiled_fn<T, NVars>(E{}), compiled_fn<T, NVars>(derivative<Is>(E{}))...};
+    }(std::make_index_sequence<NVars>{});
+}
+
+// outs[k] receives the n results of fns[k]
+// Fns is any range of compiled_fn (std::array from make_dispatch_table, std::vector, std::span, ...)
+template <class Fns, MathType T = typename Fns::value_type::Type>
+void dispatch_batch(const Fns &fns, const T *const *columns, T *const *outs, std::size_t n)
+{
+    std::size_t k = 0;
+    for (const auto &fn : fns)
+        fn.batch(columns, outs[k++], n);
+}
+
+// ---------------------------------------------- Record binding ----------------------------------------------
+
+/************************************************
+ * record_binding: Maps variable ID i to the i-th member pointer so expressions can read straight from an array of structs
+ *                 record_binding<&Sample::x, &Sample::y> -> Var 0 = Sample::x, Var 1 = Sample::y
+ *                 load<T>(record) copies the bound members into the argument array of the evaluation helpers
+ * evaluate_records: out[i] = f(records[i])
+ * evaluate_records_gradient: grads[ID][i] = d/d(Var ID) f(records[i]), one fused pass (evaluate_jet) per record
+ ***********************************************/
+
+template <class M>
+struct member_traits;
+template <class R, class M>
+struct member_traits<M R::*>
+{
+    using Record = R;
+    using Type = M;
+};
+
+template <auto First, auto... Rest>
+requires(std::is_member_object_pointer_v<decltype(First)> && (std::is_member_object_pointer_v<decltype(Rest)> && ...))
+struct record_binding
+{
+    using Record = typename member_traits<decltype(First)>::Record;
+    static_assert((std::same_as<Record, typename member_traits<decltype(Rest)>::Record> && ...), "all members must belong to the same record");
+
+    static constexpr std::size_t arity = 1 + sizeof...(Rest);
+
+    template <Expression E>
+    static auto evaluate(E, const Record &record) { return E::function(record.*First, record.*Rest...); }
+
+    template <MathType T>
+    static std::array<T, arity> load(const Record &record) { return {static_cast<T>(record.*First), static_cast<T>(record.*Rest)...}; }
+};
+
+template <class Binding, Expression E>
+void evaluate_records(E, std::span<const typename Binding::Record> records, typename E::Type *out)
+{
+    for (std::size_t i = 0; i < records.size(); ++i)
+        out[i] = Binding::evaluate(E{}, records[i]);
+}
+
+template <class Binding, Expression E>
+void evaluate_records_gradient(E, std::span<const typename Binding::Record> records, typename E::Type *const *grads)
+{
+    using T = typename E::Type;
+    // every record is read once, the derivative trees would each walk the whole buffer again
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        const auto vars = Binding::template load<T>(records[i]);
+        const auto j = evaluate_jet<Binding::arity, false>(E{}, vars.data());
+        for (std::size_t id = 0; id < Binding::arity; ++id)
+            grads[id][i] = j.grad[id];
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,288 @@
+/*
+CTDerivatives/ctdt_mmap.hpp
+Streaming evaluation over memory mapped column files (POSIX only)
+*/
+
+#ifndef CTDT_MMAP
+#define CTDT_MMAP
+
+#include "ctdt.hpp"
+
+#include <string>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------- Mapped column file ----------------------------------------------
+
+/************************************************
+ * mapped_column: A binary file holding a raw array of T (one file per variable ID) mapped into memory
+ *                mapped_column<T>(path)          maps an existing file read only, data() is const T *
+ *                mapped_column<T, true>(path, n) creates / truncates the file to n elements, allocates its blocks and maps
+ *                                                it writable, data() is T *
+ * prefetch / release: madvise hints for the element range [first, first + count)
+ * touch: Reads one byte per page of the range so the page faults happen on the calling thread
+ * Failing system calls throw std::system_error with the path as message, a file size that is not a multiple of
+ * sizeof(T) throws std::runtime_error
+ ***********************************************/
+
+template <MathType T, bool Writable = false>
+class mapped_column
+{
+public:
+    explicit mapped_column(const std::string &path)
+        requires(!Writable)
+        : path_(path), fd_(::open(path.c_str(), O_RDONLY))
+    {
+        if (fd_.fd < 0)
+            fail();
+        struct stat st{};
+        if (::fstat(fd_.fd, &st) < 0)
+            fail();
+        if (st.st_size % sizeof(T) != 0)
+            throw std::runtime_error(path + ": size is not a multiple of the element size");
+        size_ = st.st_size / sizeof(T);
+        map(PROT_READ);
+    }
+
+    mapped_column(const std::string &path, std::size_t n)
+        requires Writable
+        : path_(path), fd_(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)), size_(n)
+    {
+        if (fd_.fd < 0)
+            fail();
+        try
+        {
+            // reserve the blocks up front, a sparse file would turn a full disk into SIGBUS on the first store
+            if (n > 0)
+                if (int err = ::posix_fallocate(fd_.fd, 0, static_cast<off_t>(n * sizeof(T))); err != 0)
+                    fail(err);
+            map(PROT_READ | PROT_WRITE);
+        }
+        catch (...)
+        {
+            ::unlink(path.c_str()); // don't leave a half created output behind
+            throw;
+        }
+    }
+
+    mapped_column(mapped_column &&other) noexcept
+        : path_(std::move(other.path_)), fd_{std::exchange(other.fd_.fd, -1)}, data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)) {}
+    mapped_column(const mapped_column &) = delete;
+    mapped_column &operator=(const mapped_column &) = delete;
+    mapped_column &operator=(mapped_column &&) = delete;
+
+    ~mapped_column()
+    {
+        if (data_)
+            ::munmap(data_, bytes());
+    }
+
+    const T *data() const { return static_cast<const T *>(data_); }
+    T *data() requires Writable { return static_cast<T *>(data_); }
+    std::size_t size() const { return size_; }
+
+    void prefetch(std::size_t first, std::size_t count) const { advise(first, count, MADV_WILLNEED); }
+    void release(std::size_t first, std::size_t count) const
+    {
+        if constexpr (!Writable) // dropping dirty pages of the output is left to the kernel writeback
+            advise(first, count, MADV_DONTNEED);
+    }
+    void touch(std::size_t first, std::size_t count) const
+    {
+        if (!data_ || first >= size_)
+            return;
+        count = std::min(count, size_ - first);
+        const auto *base = static_cast<const volatile char *>(data_);
+        char sink = 0;
+        for (std::size_t byte = first * sizeof(T); byte < (first + count) * sizeof(T); byte += page_size())
+            sink = static_cast<char>(sink ^ base[byte]);
+        (void)sink;
+    }
+
+private:
+    std::size_t bytes() const { return size_ * sizeof(T); }
+    static std::size_t page_size()
+    {
+        static const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return page;
+    }
+
+    [[noreturn]] void fail(int err = errno) const { throw std::system_error(err, std::generic_category(), path_); }
+
+    void map(int prot)
+    {
+        if (size_ == 0) // mmap can't map 0 bytes
+            return;
+        void *p = ::mmap(nullptr, bytes(), prot, MAP_SHARED, fd_.fd, 0);
+        if (p == MAP_FAILED)
+            fail();
+        data_ = p;
+        ::madvise(data_, bytes(), MADV_SEQUENTIAL);
+    }
+
+    // madvise needs a page aligned start, so round the range outwards to whole pages
+    void advise(std::size_t first, std::size_t count, int advice) const
+    {
+        if (!data_ || first >= size_)
+            return;
+        count = std::min(count, size_ - first);
+        const std::size_t page = page_size();
+        auto *base = static_cast<char *>(data_);
+        std::size_t begin = first * sizeof(T) / page * page;
+        std::size_t end = (first + count) * sizeof(T);
+        ::madvise(base + begin, end - begin, advice);
+    }
+
+    // owns the descriptor on its own so it is also closed when a constructor throws
+    struct file_descriptor
+    {
+        int fd = -1;
+        file_descriptor() = default;
+        explicit file_descriptor(int f) : fd(f) {}
+        file_descriptor(const file_descriptor &) = delete;
+        file_descriptor &operator=(const file_descriptor &) = delete;
+        ~file_descriptor()
+        {
+            if (fd >= 0)
+                ::close(fd);
+        }
+    };
+
+    std::string path_;
+    file_descriptor fd_;
+    void *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// ---------------------------------------------- Streaming evaluation ----------------------------------------------
+
+/************************************************
+ * stream_dispatch: Evaluates every compiled_fn of fns over the mapped inputs (inputs[ID] holds Var ID) and writes
+ *                  the results of fns[k] to outputs[k], chunk points at a time straight from / into the mappings.
+ *                  Double buffered: while chunk c is evaluated a prefetch thread (one for the whole call) faults in the
+ *                  input pages of chunk c + 1 (the outputs get a madvise hint) and chunk c - 1 of the inputs is released.
+ *                  The arity of the compiled_fn has to match the number of inputs, an output may not be one of the inputs
+ * stream_evaluate: The expression itself into one output file
+ * stream_derivative: d/d(Var DVar) of the expression into one output file
+ * stream_gradient: Every first derivative, outputs[ID] receives d/d(Var ID)
+ ***********************************************/
+
+constexpr std::size_t default_stream_chunk = std::size_t{1} << 16;
+
+template <class Fns, std::size_t NVars, MathType T = typename Fns::value_type::Type>
+void stream_dispatch(const Fns &fns, const std::array<std::string, NVars> &inputs, const std::vector<std::string> &outputs,
+                     std::size_t chunk = default_stream_chunk)
+{
+    static_assert(Fns::value_type::arity == NVars, "stream_dispatch: need one input file per variable of the functions");
+    if (outputs.size() != std::size(fns))
+        throw std::invalid_argument("stream_dispatch: need one output file per function");
+    for (const auto &output : outputs)
+        for (const auto &input : inputs)
+        {
+            std::error_code ec; // a missing output is fine, it gets created
+            if (output == input || std::filesystem::equivalent(output, input, ec))
+                throw std::invalid_argument("stream_dispatch: output " + output + " is also an input");
+        }
+    chunk = std::max<std::size_t>(chunk, 1);
+
+    std::vector<mapped_column<T>> in;
+    in.reserve(NVars);
+    for (const auto &path : inputs)
+        in.emplace_back(path);
+    std::size_t n = NVars ? in.front().size() : 0;
+    for (const auto &column : in)
+        if (column.size() != n)
+            throw std::runtime_error("stream_dispatch: input columns differ in length");
+
+    std::vector<mapped_column<T, true>> out;
+    out.reserve(outputs.size());
+    for (const auto &path : outputs)
+        out.emplace_back(path, n);
+
+    // One prefetch thread for the whole call, it faults in the newest chunk it was handed (a stale request is skipped
+    // if it falls behind). Declared after in so it is stopped and joined before the inputs are unmapped
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::size_t ahead = 0;
+    bool pending = false;
+    std::jthread prefetcher([&](std::stop_token stop)
+    {
+        std::unique_lock lock(mutex);
+        while (wake.wait(lock, stop, [&] { return pending; }))
+        {
+            const std::size_t first = ahead;
+            pending = false;
+            lock.unlock();
+            for (const auto &column : in)
+                column.touch(first, chunk);
+            lock.lock();
+        }
+    });
+
+    std::array<const T *, NVars> columns{};
+    std::vector<T *> results(out.size());
+    for (std::size_t first = 0; first < n; first += chunk)
+    {
+        std::size_t count = std::min(chunk, n - first);
+        if (first + count < n)
+        {
+            {
+                std::lock_guard lock(mutex);
+                ahead = first + count;
+                pending = true;
+            }
+            wake.notify_one();
+        }
+        for (const auto &column : out)
+            column.prefetch(first + count, chunk);
+
+        for (std::size_t id = 0; id < NVars; ++id)
+            columns[id] = in[id].data() + first;
+        for (std::size_t k = 0; k < out.size(); ++k)
+            results[k] = out[k].data() + first;
+        dispatch_batch(fns, columns.data(), results.data(), count);
+
+        if (first >= chunk)
+            for (const auto &column : in)
+                column.release(first - chunk, chunk);
+    }
+}
+
+template <std::size_t NVars, Expression E>
+void stream_evaluate(E, const std::array<std::string, NVars> &inputs, const std::string &output, std::size_t chunk = default_stream_chunk)
+{
+    std::array<compiled_fn<typename E::Type, NVars>, 1> fns{E{}};
+    stream_dispatch(fns, inputs, {output}, chunk);
+}
+
+template <std::size_t DVar, std::size_t NVars, Expression E>
+void stream_derivative(E, const std::array<std::string, NVars> &inputs, const std::string &output, std::size_t chunk = default_stream_chunk)
+{
+    stream_evaluate(derivative<DVar>(E{}), inputs, output, chunk);
+}
+
+template <std::size_t NVars, Expression E>
+void stream_gradient(E, const std::array<std::string, NVars> &inputs, const std::array<std::string, NVars> &outputs,
+                     std::size_t chunk = default_stream_chunk)
+{
+    auto table = make_dispatch_table<NVars>(E{});
+    std::span<const compiled_fn<typename E::Type, NVars>> gradient(table.begin() + 1, table.end());
+    stream_dispatch(gradient, inputs, std::vector<std::string>(outputs.begin(), outputs.end()), chunk);
+}
+
+#endif
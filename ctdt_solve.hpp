@@ -0,0 +1,472 @@
+/*
+CTDerivatives/ctdt_solve.hpp
+Newton, bracketed Newton and L-BFGS solvers on top of the fused value / derivative evaluation
+*/
+
+#ifndef CTDT_SOLVE
+#define CTDT_SOLVE
+
+#include "ctdt.hpp"
+
+#include <vector>
+#include <algorithm>
+
+// ---------------------------------------------- Options and results ----------------------------------------------
+
+struct solver_options
+{
+    double tolerance = 1e-12;         // |f| for roots, max |grad| for minimization
+    std::size_t max_iterations = 100;
+};
+
+template <MathType T>
+struct root_result
+{
+    T x;
+    T value;
+    std::size_t iterations;
+    bool converged;
+};
+
+template <MathType T, std::size_t NVars>
+struct solve_result
+{
+    std::array<T, NVars> x;
+    T value; // f(x) when minimizing, max |F_i(x)| for systems
+    std::size_t iterations;
+    bool converged;
+};
+
+// ---------------------------------------------- Dense helpers ----------------------------------------------
+
+// Solves a * x = b in place (b becomes x) with partial pivoting, false if a is singular
+template <MathType T, std::size_t N>
+bool solve_linear(std::array<T, N * N> &a, std::array<T, N> &b)
+{
+    for (std::size_t col = 0; col < N; ++col)
+    {
+        std::size_t pivot = col;
+        for (std::size_t row = col + 1; row < N; ++row)
+            if (std::abs(a[row * N + col]) > std::abs(a[pivot * N + col]))
+                pivot = row;
+        if (a[pivot * N + col] == T{0})
+            return false;
+        if (pivot != col)
+        {
+            for (std::size_t k = 0; k < N; ++k)
+                std::swap(a[col * N + k], a[pivot * N + k]);
+            std::swap(b[col], b[pivot]);
+        }
+        for (std::size_t row = col + 1; row < N; ++row)
+        {
+            T factor = a[row * N + col] / a[col * N + col];
+            for (std::size_t k = col; k < N; ++k)
+                a[row * N + k] = a[row * N + k] - factor * a[col * N + k];
+            b[row] = b[row] - factor * b[col];
+        }
+    }
+    for (std::size_t i = N; i-- > 0;)
+    {
+        for (std::size_t k = i + 1; k < N; ++k)
+            b[i] = b[i] - a[i * N + k] * b[k];
+        b[i] = b[i] / a[i * N + i];
+    }
+    return true;
+}
+
+template <MathType T, std::size_t N>
+T dot(const std::array<T, N> &a, const std::array<T, N> &b)
+{
+    T sum{0};
+    for (std::size_t i = 0; i < N; ++i)
+        sum = sum + a[i] * b[i];
+    return sum;
+}
+
+template <MathType T, std::size_t N>
+T max_abs(const std::array<T, N> &a)
+{
+    T m{0};
+    for (const auto &v : a)
+        m = std::max(m, static_cast<T>(std::abs(v)));
+    return m;
+}
+
+// ---------------------------------------------- Scalar Newton with bracketing ----------------------------------------------
+
+/************************************************
+ * newton_bracketed: Root of f in Var 0 inside [lo, hi], f(lo) and f(hi) need opposite signs
+ *                   vars[0] is the initial guess (midpoint if outside the bracket), vars[1..] are fixed parameters
+ *                   Newton steps leaving the bracket (or a zero derivative) fall back to bisection
+ * newton_bracketed_batch: The same for n independent problems stepped in lockstep, x[i] is the guess and the root of
+ *                   problem i and columns[ID][i] the parameter Var ID of it (columns[0] is unused).
+ *                   converged[i] tells if problem i converged (unbracketed problems keep their guess and report false),
+ *                   returns the number of converged problems.
+ *                   The lane loop is branch free (selects only), it vectorizes when the expression does, i.e. for
+ *                   arithmetic expressions or with vector math functions (-ffast-math with libmvec).
+ *                   Pass a newton_batch_workspace to reuse the lane state between calls instead of allocating it
+ * Value and derivative come from one fused evaluation per iteration
+ ***********************************************/
+
+template <std::size_t NVars = 1, Expression E>
+root_result<typename E::Type> newton_bracketed(E, typename E::Type lo, typename E::Type hi, std::array<typename E::Type, NVars> vars = {},
+                                               solver_options options = {})
+{
+    using T = typename E::Type;
+    const T tolerance = static_cast<T>(options.tolerance);
+    auto at = [&](T x) { vars[0] = x; return evaluate<NVars>(E{}, vars.data()); };
+
+    const T guess = vars[0]; // at() overwrites vars[0]
+    T flo = at(lo), fhi = at(hi);
+    if (flo == T{0})
+        return {lo, flo, 0, true};
+    if (fhi == T{0})
+        return {hi, fhi, 0, true};
+    if ((flo < T{0}) == (fhi < T{0}))
+        return {lo, flo, 0, false}; // not bracketed
+    if (flo > T{0})
+        std::swap(lo, hi); // f(lo) < 0 < f(hi) from here on
+
+    T x = guess;
+    if (!(std::min(lo, hi) < x && x < std::max(lo, hi)))
+        x = (lo + hi) / T{2};
+    for (std::size_t it = 1; it <= options.max_iterations; ++it)
+    {
+        vars[0] = x;
+        std::array<T, NVars> grad{};
+        const T fx = evaluate_value_gradient<NVars>(E{}, vars.data(), grad.data());
+        const T dfx = grad[0];
+        if (std::abs(fx) <= tolerance)
+            return {x, fx, it, true};
+        (fx < T{0} ? lo : hi) = x;
+
+        T next = x - fx / dfx;
+        if (dfx == T{0} || !(std::min(lo, hi) < next && next < std::max(lo, hi)))
+            next = (lo + hi) / T{2};
+        if (std::abs(next - x) <= tolerance * (T{1} + std::abs(x)))
+            return {next, at(next), it, true};
+        x = next;
+    }
+    return {x, at(x), options.max_iterations, false}; // fx belongs to the point before the last step
+}
+
+// Lane state of newton_bracketed_batch as contiguous arrays, a is the end with f < 0 and b the end with f > 0.
+// Every iteration reads one copy and writes the other so all loads and stores are unconditional,
+// an in place "a[i] = act ? ai : a[i]" would be turned back into a branch and block vectorization.
+// Reusing one workspace across calls keeps the allocations out of the solve once it has grown to n
+template <MathType T>
+struct newton_batch_workspace
+{
+    struct lanes
+    {
+        std::vector<T> x{}, a{}, b{};
+        std::vector<unsigned char> active{}, converged{};
+    };
+    std::array<lanes, 2> state{};
+
+    void resize(std::size_t n)
+    {
+        for (auto &l : state)
+        {
+            l.x.resize(n);
+            l.a.resize(n);
+            l.b.resize(n);
+            l.active.resize(n);
+            l.converged.resize(n);
+        }
+    }
+};
+
+template <std::size_t NVars = 1, Expression E>
+std::size_t newton_bracketed_batch(E, const typename E::Type *const *columns, const typename E::Type *lo, const typename E::Type *hi,
+                                   typename E::Type *x, bool *converged, std::size_t n, newton_batch_workspace<typename E::Type> &workspace,
+                                   solver_options options = {})
+{
+    using T = typename E::Type;
+    using lanes = typename newton_batch_workspace<T>::lanes;
+    const T tolerance = static_cast<T>(options.tolerance);
+    workspace.resize(n);
+    auto &state = workspace.state;
+
+    auto value_derivative = [columns](std::size_t i, T xi, T &dfx)
+    {
+        return [&]<std::size_t... Is>(std::index_sequence<Is...>)
+        {
+            const std::array<T, NVars> vars{(Is == 0 ? xi : columns[Is][i])...};
+            const auto j = evaluate_jet<NVars, false>(E{}, vars.data());
+            dfx = j.grad[0];
+            return j.value;
+        }(std::make_index_sequence<NVars>{});
+    };
+
+    {
+        lanes &l = state[0];
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            T d;
+            const T l0 = lo[i], h0 = hi[i], x0 = x[i];
+            const T fa = value_derivative(i, l0, d), fb = value_derivative(i, h0, d);
+            const bool swap = fa > T{0};
+            const T ai = swap ? h0 : l0;
+            const T bi = swap ? l0 : h0;
+            const bool end_is_root = (fa == T{0}) | (fb == T{0});
+            const bool bracketed = (fa < T{0}) != (fb < T{0});
+            const bool inside = (x0 - ai) * (x0 - bi) < T{0};
+            l.a[i] = ai;
+            l.b[i] = bi;
+            l.x[i] = end_is_root ? (fa == T{0} ? l0 : h0) : (bracketed & !inside) ? (ai + bi) / T{2} : x0;
+            l.converged[i] = end_is_root;
+            l.active[i] = bracketed & !end_is_root; // unbracketed lanes keep their guess and stay unconverged
+        }
+    }
+
+    std::size_t cur = 0;
+    for (std::size_t it = 0; it < options.max_iterations; ++it)
+    {
+        const lanes &in = state[cur];
+        lanes &out = state[cur ^ 1];
+        const T *xs = in.x.data(), *as = in.a.data(), *bs = in.b.data();
+        const unsigned char *act_in = in.active.data(), *conv_in = in.converged.data();
+        T *x_out = out.x.data(), *a_out = out.a.data(), *b_out = out.b.data();
+        unsigned char *act_out = out.active.data(), *conv_out = out.converged.data();
+
+        // branch free, finished lanes are still computed but the selects drop their results.
+        // Lanes are independent and the two copies never overlap, ivdep spares the vectorizer the alias checks
+        unsigned char remaining = 0;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC ivdep
+#endif
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const bool act = act_in[i];
+            const T xi = xs[i], a0 = as[i], b0 = bs[i];
+            T dfx;
+            const T fx = value_derivative(i, xi, dfx);
+            const bool negative = fx < T{0};
+            const T ai = negative ? xi : a0;
+            const T bi = negative ? b0 : xi;
+
+            const T newton = xi - fx / dfx;
+            const bool inside = (newton - ai) * (newton - bi) < T{0}; // strictly between the ends, false for inf / nan from dfx == 0
+            // (newton + newton) / 2 or the midpoint, selecting the operands keeps the arithmetic unconditional
+            // (a conditional add could trap and would stop the if conversion)
+            const T next = ((inside ? newton : ai) + (inside ? newton : bi)) / T{2};
+            const bool at_root = std::abs(fx) <= tolerance;
+            const bool done = at_root | (std::abs(next - xi) <= tolerance * (T{1} + std::abs(xi)));
+
+            a_out[i] = act ? ai : a0;
+            b_out[i] = act ? bi : b0;
+            x_out[i] = (act & !at_root) ? next : xi;
+            conv_out[i] = conv_in[i] | (act & done);
+            act_out[i] = act & !done;
+            remaining |= act_out[i];
+        }
+        cur ^= 1;
+        if (remaining == 0)
+            break;
+    }
+
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        x[i] = state[cur].x[i];
+        converged[i] = state[cur].converged[i];
+        count += converged[i];
+    }
+    return count;
+}
+
+template <std::size_t NVars = 1, Expression E>
+std::size_t newton_bracketed_batch(E, const typename E::Type *const *columns, const typename E::Type *lo, const typename E::Type *hi,
+                                   typename E::Type *x, bool *converged, std::size_t n, solver_options options = {})
+{
+    newton_batch_workspace<typename E::Type> workspace;
+    return newton_bracketed_batch<NVars>(E{}, columns, lo, hi, x, converged, n, workspace, options);
+}
+
+// ---------------------------------------------- Multivariate Newton ----------------------------------------------
+
+/************************************************
+ * newton_minimize: Minimizes f over all NVars variables with Newton steps from the hessian
+ *                  falls back to steepest descent if the hessian is singular or the step is no descent direction
+ *                  and backtracks until the step decreases f, value, gradient and hessian of the accepted trial are reused
+ *                  for the next step
+ * newton_system: Root of the system F_r(x) = 0 for a tuple of NVars expressions, steps from the jacobian
+ *                J[r][c] = d/d(Var c) F_r, backtracks until max |F_r| decreases
+ *                F and J come from one fused pass per row, the jacobian of the accepted trial is reused for the next step
+ ***********************************************/
+
+template <std::size_t NVars, Expression E>
+solve_result<typename E::Type, NVars> newton_minimize(E, std::array<typename E::Type, NVars> x, solver_options options = {})
+{
+    using T = typename E::Type;
+    const T tolerance = static_cast<T>(options.tolerance);
+    std::array<T, NVars> grad{}, step{};
+    std::array<T, NVars * NVars> hess{};
+
+    T value = evaluate_value_gradient_hessian<NVars>(E{}, x.data(), grad.data(), hess.data());
+    for (std::size_t it = 0; it < options.max_iterations; ++it)
+    {
+        if (max_abs(grad) <= tolerance)
+            return {x, value, it, true};
+
+        for (std::size_t i = 0; i < NVars; ++i)
+            step[i] = -grad[i];
+        if (!solve_linear<T, NVars>(hess, step) || !(dot(step, grad) < T{0})) // hess is overwritten, the accepted trial below refills it
+            for (std::size_t i = 0; i < NVars; ++i)
+                step[i] = -grad[i];
+
+        T alpha{1}, trial_value = value;
+        std::array<T, NVars> trial{}, trial_grad{};
+        bool accepted = false;
+        for (int halvings = 0; halvings < 50 && !accepted; ++halvings, alpha = alpha / T{2})
+        {
+            for (std::size_t i = 0; i < NVars; ++i)
+                trial[i] = x[i] + alpha * step[i];
+            trial_value = evaluate_value_gradient_hessian<NVars>(E{}, trial.data(), trial_grad.data(), hess.data());
+            accepted = trial_value < value;
+        }
+        if (!accepted)
+            return {x, value, it, false}; // no decrease possible in floating point
+        x = trial;
+        grad = trial_grad;
+        value = trial_value;
+    }
+    return {x, value, options.max_iterations, max_abs(grad) <= tolerance};
+}
+
+template <Expression... Es, MathType T = typename std::tuple_element_t<0, std::tuple<Es...>>::Type>
+solve_result<T, sizeof...(Es)> newton_system(std::tuple<Es...>, std::array<T, sizeof...(Es)> x, solver_options options = {})
+{
+    constexpr std::size_t N = sizeof...(Es);
+    const T tolerance = static_cast<T>(options.tolerance);
+    // F and its jacobian from one fused pass per row
+    auto residual_jacobian = [](const std::array<T, N> &at, std::array<T, N> &f, std::array<T, N * N> &jacobian)
+    {
+        [&]<std::size_t... Rs>(std::index_sequence<Rs...>) { ((f[Rs] = evaluate_value_gradient<N>(Es{}, at.data(), jacobian.data() + Rs * N)), ...); }(std::make_index_sequence<N>{});
+    };
+
+    std::array<T, N> f{};
+    std::array<T, N * N> jacobian{};
+    residual_jacobian(x, f, jacobian);
+    for (std::size_t it = 0; it < options.max_iterations; ++it)
+    {
+        if (max_abs(f) <= tolerance)
+            return {x, max_abs(f), it, true};
+
+        std::array<T, N> step{};
+        for (std::size_t r = 0; r < N; ++r)
+            step[r] = -f[r];
+        if (!solve_linear<T, N>(jacobian, step)) // jacobian is overwritten, the accepted trial below refills it
+            return {x, max_abs(f), it, false};
+
+        T alpha{1};
+        std::array<T, N> trial{}, ftrial{};
+        bool accepted = false;
+        for (int halvings = 0; halvings < 50 && !accepted; ++halvings, alpha = alpha / T{2})
+        {
+            for (std::size_t i = 0; i < N; ++i)
+                trial[i] = x[i] + alpha * step[i];
+            residual_jacobian(trial, ftrial, jacobian);
+            accepted = max_abs(ftrial) < max_abs(f);
+        }
+        if (!accepted)
+            return {x, max_abs(f), it, false};
+        x = trial;
+        f = ftrial;
+    }
+    return {x, max_abs(f), options.max_iterations, max_abs(f) <= tolerance};
+}
+
+// ---------------------------------------------- L-BFGS ----------------------------------------------
+
+/************************************************
+ * lbfgs_minimize: Minimizes f with L-BFGS keeping the last History steps, value and gradient come from one fused
+ *                 evaluation per line search trial. Backtracking (Armijo) line search
+ ***********************************************/
+
+template <std::size_t NVars, std::size_t History = 8, Expression E>
+solve_result<typename E::Type, NVars> lbfgs_minimize(E, std::array<typename E::Type, NVars> x, solver_options options = {})
+{
+    using T = typename E::Type;
+    using Vec = std::array<T, NVars>;
+    const T tolerance = static_cast<T>(options.tolerance);
+
+    std::array<Vec, History> s{}, y{};
+    std::array<T, History> rho{}, alpha{};
+    std::size_t stored = 0, newest = 0;
+
+    Vec grad{}, direction{}, trial{}, trial_grad{};
+    T value = evaluate_value_gradient<NVars>(E{}, x.data(), grad.data());
+    for (std::size_t it = 0; it < options.max_iterations; ++it)
+    {
+        if (max_abs(grad) <= tolerance)
+            return {x, value, it, true};
+
+        // two loop recursion, direction = -H * grad
+        direction = grad;
+        for (std::size_t k = 0; k < stored; ++k)
+        {
+            std::size_t j = (newest + History - k) % History;
+            alpha[j] = rho[j] * dot(s[j], direction);
+            for (std::size_t i = 0; i < NVars; ++i)
+                direction[i] = direction[i] - alpha[j] * y[j][i];
+        }
+        if (stored > 0)
+        {
+            T gamma = dot(s[newest], y[newest]) / dot(y[newest], y[newest]);
+            for (auto &d : direction)
+                d = d * gamma;
+        }
+        for (std::size_t k = stored; k-- > 0;)
+        {
+            std::size_t j = (newest + History - k) % History;
+            T beta = rho[j] * dot(y[j], direction);
+            for (std::size_t i = 0; i < NVars; ++i)
+                direction[i] = direction[i] + s[j][i] * (alpha[j] - beta);
+        }
+        for (auto &d : direction)
+            d = -d;
+        if (!(dot(direction, grad) < T{0})) // lost descent, restart from steepest descent
+        {
+            stored = 0;
+            for (std::size_t i = 0; i < NVars; ++i)
+                direction[i] = -grad[i];
+        }
+
+        T step{1}, trial_value = value;
+        const T slope = dot(direction, grad);
+        bool accepted = false;
+        for (int halvings = 0; halvings < 50 && !accepted; ++halvings, step = step / T{2})
+        {
+            for (std::size_t i = 0; i < NVars; ++i)
+                trial[i] = x[i] + step * direction[i];
+            trial_value = evaluate_value_gradient<NVars>(E{}, trial.data(), trial_grad.data());
+            accepted = trial_value <= value + static_cast<T>(1e-4) * step * slope;
+        }
+        if (!accepted)
+            return {x, value, it, false};
+
+        Vec s_new{}, y_new{};
+        for (std::size_t i = 0; i < NVars; ++i)
+        {
+            s_new[i] = trial[i] - x[i];
+            y_new[i] = trial_grad[i] - grad[i];
+        }
+        T sy = dot(s_new, y_new);
+        if (sy > T{0}) // keep the pair only if it keeps the hessian approximation positive definite
+        {
+            newest = stored == 0 ? 0 : (newest + 1) % History;
+            s[newest] = s_new;
+            y[newest] = y_new;
+            rho[newest] = T{1} / sy;
+            stored = std::min(stored + 1, History);
+        }
+        x = trial;
+        grad = trial_grad;
+        value = trial_value;
+    }
+    return {x, value, options.max_iterations, max_abs(grad) <= tolerance};
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "kernel_model.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(CompiledFn, FromExpression)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    compiled_fn<double, 2> f = x * y + Sin(x);
+    EXPECT_FLOAT_EQ(f(2, 3), 6 + std::sin(2.0));
+    EXPECT_FLOAT_EQ(f(2, 3, 42), 6 + std::sin(2.0));
+
+    double vars[] = {1, -1};
+    EXPECT_FLOAT_EQ(f(vars), -1 + std::sin(1.0));
+}
+
+TEST(CompiledFn, FromCompiledKernel)
+{
+    compiled_fn<double, 2> f(model, model_batch);
+    double vars[] = {2, 3};
+    EXPECT_FLOAT_EQ(f(2, 3), model(vars));
+}
+
+TEST(CompiledFn, HeterogeneousBatch)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    std::vector<compiled_fn<double, 2>> models{x + y, x * y, Exp(x) - y, compiled_fn<double, 2>(model, model_batch)};
+
+    double xs[] = {0, 1, 2, 3};
+    double ys[] = {1, 2, 3, 4};
+    const double *columns[] = {xs, ys};
+    std::vector<std::array<double, 4>> results(models.size());
+    std::vector<double *> outs;
+    for (auto &r : results)
+        outs.push_back(r.data());
+
+    dispatch_batch(models, columns, outs.data(), 4);
+    for (std::size_t k = 0; k < models.size(); ++k)
+        for (std::size_t i = 0; i < 4; ++i)
+            EXPECT_FLOAT_EQ(results[k][i], models[k](xs[i], ys[i]));
+    EXPECT_FLOAT_EQ(results[1][3], 12);
+}
+
+TEST(CompiledFn, DispatchTable)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto table = make_dispatch_table<2>(x * x * y); // f, 2xy, x²
+    EXPECT_EQ(table.size(), 3u);
+
+    double xs[] = {1, 2, 3};
+    double ys[] = {2, 2, 2};
+    const double *columns[] = {xs, ys};
+    double f[3], dx[3], dy[3];
+    double *outs[] = {f, dx, dy};
+    dispatch_batch(table, columns, outs, 3);
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_FLOAT_EQ(f[i], xs[i] * xs[i] * ys[i]);
+        EXPECT_FLOAT_EQ(dx[i], 2 * xs[i] * ys[i]);
+        EXPECT_FLOAT_EQ(dy[i], xs[i] * xs[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,60 @@
+#include "kernel_model.hpp"
+#include <gtest/gtest.h>
+
+// f(x, y) = sin(e^x * y) + x^y is only instantiated in kernel_model.cpp
+
+TEST(CompiledKernel, Scalar)
+{
+    double vars[] = {0, 0};
+    EXPECT_FLOAT_EQ(model(vars), 1.0); // sin(0) + 0^0
+    double vars2[] = {2, 3};
+    EXPECT_FLOAT_EQ(model(vars2), std::sin(std::exp(2.0) * 3.0) + 8.0);
+}
+
+TEST(CompiledKernel, Batch)
+{
+    double xs[] = {1, 2, 3};
+    double ys[] = {1, 2, 0.5};
+    const double *columns[] = {xs, ys};
+    double out[3];
+    model_batch(columns, out, 3);
+    for (int i = 0; i < 3; ++i)
+    {
+        double vars[] = {xs[i], ys[i]};
+        EXPECT_FLOAT_EQ(out[i], model(vars));
+    }
+}
+
+TEST(CompiledKernel, Gradient)
+{
+    double vars[] = {1, 2};
+    double grad[2];
+    model_gradient(vars, grad);
+    double e = std::exp(1.0);
+    EXPECT_NEAR(grad[0], std::cos(e * 2) * e * 2 + 2.0, 0.00001); // cos(e^x y) e^x y + y x^(y-1)
+    EXPECT_NEAR(grad[1], std::cos(e * 2) * e, 0.00001);           // cos(e^x y) e^x + x^y ln(x)
+}
+
+TEST(CompiledKernel, GradientBatch)
+{
+    double xs[] = {1, 2};
+    double ys[] = {2, 3};
+    const double *columns[] = {xs, ys};
+    double dx[2], dy[2];
+    double *grads[] = {dx, dy};
+    model_gradient_batch(columns, grads, 2);
+    for (int i = 0; i < 2; ++i)
+    {
+        double vars[] = {xs[i], ys[i]};
+        double grad[2];
+        model_gradient(vars, grad);
+        EXPECT_FLOAT_EQ(dx[i], grad[0]);
+        EXPECT_FLOAT_EQ(dy[i], grad[1]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
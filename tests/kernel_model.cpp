@@ -0,0 +1,9 @@
+#include "kernel_model.hpp"
+
+namespace
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+}
+
+GenerateCompiledKernel(model, 2, Sin(Exp(x) * y) + Pow(x, y));
@@ -0,0 +1,3 @@
+#include "../ctdt.hpp"
+
+DeclareCompiledKernel(model, double);
@@ -0,0 +1,179 @@
+#include "../ctdt_mmap.hpp"
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace
+{
+    std::vector<double> read_column(const std::string &path)
+    {
+        mapped_column<double> column(path);
+        return {column.data(), column.data() + column.size()};
+    }
+
+    // enough points to run over several chunks and a partial last chunk
+    std::vector<double> iota(std::size_t n, double start, double step)
+    {
+        std::vector<double> v(n);
+        for (std::size_t i = 0; i < n; ++i)
+            v[i] = start + step * static_cast<double>(i);
+        return v;
+    }
+}
+
+// Every test gets its own directory (process id and test name) that is removed again in the teardown
+class TempDirectory : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        const auto *info = testing::UnitTest::GetInstance()->current_test_info();
+        dir_ = std::filesystem::temp_directory_path() /
+               ("ctdt_mmapstream_" + std::to_string(::getpid()) + "_" + info->test_suite_name() + "_" + info->name());
+        std::filesystem::create_directories(dir_);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(dir_, ec);
+    }
+
+    std::string temp_path(const std::string &name) const { return (dir_ / name).string(); }
+
+    std::string write_column(const std::string &name, const std::vector<double> &values) const
+    {
+        auto path = temp_path(name);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(double)));
+        return path;
+    }
+
+    std::filesystem::path dir_{};
+};
+
+class MappedColumn : public TempDirectory
+{
+};
+
+class StreamEvaluate : public TempDirectory
+{
+};
+
+TEST_F(MappedColumn, RoundTrip)
+{
+    auto path = temp_path("roundtrip");
+    {
+        mapped_column<double, true> column(path, 5);
+        for (std::size_t i = 0; i < 5; ++i)
+            column.data()[i] = static_cast<double>(i) * 1.5;
+    }
+    auto values = read_column(path);
+    ASSERT_EQ(values.size(), 5u);
+    EXPECT_FLOAT_EQ(values[4], 6.0);
+}
+
+TEST_F(MappedColumn, ReadOnlyData)
+{
+    static_assert(std::is_same_v<decltype(std::declval<mapped_column<double> &>().data()), const double *>);
+    static_assert(std::is_same_v<decltype(std::declval<mapped_column<double, true> &>().data()), double *>);
+    static_assert(!std::is_constructible_v<mapped_column<double>, std::string, std::size_t>);
+    static_assert(!std::is_constructible_v<mapped_column<double, true>, std::string>);
+}
+
+TEST_F(MappedColumn, MissingFile)
+{
+    EXPECT_THROW(mapped_column<double>(temp_path("does_not_exist")), std::system_error);
+}
+
+TEST_F(MappedColumn, BadSizeDoesNotLeak)
+{
+    auto path = temp_path("badsize");
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write("abc", 3);
+    }
+    auto open_fds = [] { return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator{}); };
+    auto before = open_fds();
+    for (int i = 0; i < 10; ++i)
+        EXPECT_THROW(mapped_column<double>{path}, std::runtime_error);
+    EXPECT_EQ(open_fds(), before);
+}
+
+TEST_F(MappedColumn, OutputIsAllocated)
+{
+    // a sparse output would only find out about a full disk on the first store into the mapping (SIGBUS)
+    auto path = temp_path("allocated");
+    mapped_column<double, true> column(path, 100000);
+    struct stat st{};
+    ASSERT_EQ(::stat(path.c_str(), &st), 0);
+    EXPECT_EQ(static_cast<std::size_t>(st.st_size), 100000 * sizeof(double));
+    EXPECT_GE(static_cast<std::size_t>(st.st_blocks) * 512, 100000 * sizeof(double));
+}
+
+TEST_F(StreamEvaluate, Value)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto xs = iota(1000, 0.0, 0.01);
+    auto ys = iota(1000, 1.0, 0.5);
+    std::array<std::string, 2> inputs{write_column("x", xs), write_column("y", ys)};
+    auto output = temp_path("f");
+
+    auto f = Sin(x) * y + Exp(y / Constant<double, 100.0>{});
+    stream_evaluate(f, inputs, output, 64);
+
+    auto result = read_column(output);
+    ASSERT_EQ(result.size(), xs.size());
+    for (std::size_t i = 0; i < xs.size(); ++i)
+        EXPECT_FLOAT_EQ(result[i], f(xs[i], ys[i]));
+}
+
+TEST_F(StreamEvaluate, DerivativeAndGradient)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto xs = iota(777, -1.0, 0.003);
+    auto ys = iota(777, 2.0, 0.25);
+    std::array<std::string, 2> inputs{write_column("gx", xs), write_column("gy", ys)};
+    std::array<std::string, 2> outputs{temp_path("dx"), temp_path("dy")};
+    auto dyf_path = temp_path("dyf");
+
+    auto f = x * x * y;
+    stream_gradient(f, inputs, outputs, 100);
+    stream_derivative<1>(f, inputs, dyf_path, 100);
+
+    auto dx = read_column(outputs[0]);
+    auto dy = read_column(outputs[1]);
+    auto dyf = read_column(dyf_path);
+    for (std::size_t i = 0; i < xs.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(dx[i], 2 * xs[i] * ys[i]);
+        EXPECT_FLOAT_EQ(dy[i], xs[i] * xs[i]);
+        EXPECT_FLOAT_EQ(dyf[i], dy[i]);
+    }
+}
+
+TEST_F(StreamEvaluate, LengthMismatch)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    std::array<std::string, 2> inputs{write_column("short", iota(3, 0, 1)), write_column("long", iota(4, 0, 1))};
+    EXPECT_THROW(stream_evaluate(x + y, inputs, temp_path("mismatch")), std::runtime_error);
+}
+
+TEST_F(StreamEvaluate, OutputIsInput)
+{
+    Variable<double, 0, 'x'> x;
+    auto path = write_column("inout", iota(10, 0, 1));
+    std::array<std::string, 1> inputs{path};
+    EXPECT_THROW(stream_evaluate(x * x, inputs, path), std::invalid_argument);
+    EXPECT_EQ(read_column(path).size(), 10u); // the input is untouched
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,81 @@
+#include "../ctdt.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace
+{
+    struct Sample
+    {
+        double x, y, z, w;
+    };
+}
+
+TEST(RecordBinding, Evaluate)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    Variable<double, 2, 'z'> z;
+    auto f = x * y + Sin(z);
+    std::vector<Sample> samples{{1, 2, 0, 9}, {3, 4, 1, 9}, {-1, 5, 2, 9}};
+    std::vector<double> out(samples.size());
+
+    using bind = record_binding<&Sample::x, &Sample::y, &Sample::z>;
+    static_assert(bind::arity == 3);
+    evaluate_records<bind>(f, std::span<const Sample>(samples), out.data());
+    for (std::size_t i = 0; i < samples.size(); ++i)
+        EXPECT_FLOAT_EQ(out[i], f(samples[i].x, samples[i].y, samples[i].z));
+}
+
+TEST(RecordBinding, MemberOrder)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    std::vector<Sample> samples{{1, 2, 3, 4}};
+    double out;
+
+    evaluate_records<record_binding<&Sample::w, &Sample::y>>(x - y, std::span<const Sample>(samples), &out); // Var 0 = w, Var 1 = y
+    EXPECT_FLOAT_EQ(out, 2.0);
+}
+
+TEST(RecordBinding, Gradient)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto f = x * x * y;
+    std::vector<Sample> samples{{1, 2, 0, 0}, {3, 4, 0, 0}};
+    double dx[2], dy[2];
+    double *grads[] = {dx, dy};
+
+    evaluate_records_gradient<record_binding<&Sample::x, &Sample::y>>(f, std::span<const Sample>(samples), grads);
+    for (std::size_t i = 0; i < samples.size(); ++i)
+    {
+        EXPECT_FLOAT_EQ(dx[i], 2 * samples[i].x * samples[i].y);
+        EXPECT_FLOAT_EQ(dy[i], samples[i].x * samples[i].x);
+    }
+}
+
+TEST(RecordBinding, GradientMatchesDerivativeTrees)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    Variable<double, 2, 'z'> z;
+    auto f = Sin(x * y) / z + Exp(z - x);
+    std::vector<Sample> samples{{0.5, 2, 1.5, 9}, {1, -1, 3, 9}, {-2, 0.25, 0.5, 9}};
+    double dz[3], dx[3], dw[3];
+    double *grads[] = {dz, dx, dw};
+
+    evaluate_records_gradient<record_binding<&Sample::z, &Sample::x, &Sample::w>>(f, std::span<const Sample>(samples), grads); // Var 0 = z, Var 1 = x, Var 2 = w
+    for (std::size_t i = 0; i < samples.size(); ++i)
+    {
+        const auto &s = samples[i];
+        EXPECT_NEAR(dz[i], derivative<0>(f)(s.z, s.x, s.w), 1e-12);
+        EXPECT_NEAR(dx[i], derivative<1>(f)(s.z, s.x, s.w), 1e-12);
+        EXPECT_NEAR(dw[i], derivative<2>(f)(s.z, s.x, s.w), 1e-12);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
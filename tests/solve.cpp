@@ -0,0 +1,191 @@
+#include "../ctdt_solve.hpp"
+#include <gtest/gtest.h>
+
+TEST(FusedEvaluation, ValueGradientHessian)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto f = x * x * y + Sin(y);
+    double vars[] = {2, 3};
+    double grad[2], hess[4];
+    double value = evaluate_value_gradient_hessian<2>(f, vars, grad, hess);
+    EXPECT_FLOAT_EQ(value, 12 + std::sin(3.0));
+    EXPECT_FLOAT_EQ(grad[0], 12);                  // 2xy
+    EXPECT_FLOAT_EQ(grad[1], 4 + std::cos(3.0));   // x² + cos(y)
+    EXPECT_FLOAT_EQ(hess[0], 6);                   // 2y
+    EXPECT_FLOAT_EQ(hess[1], 4);                   // 2x
+    EXPECT_FLOAT_EQ(hess[2], 4);
+    EXPECT_FLOAT_EQ(hess[3], -std::sin(3.0));
+}
+
+TEST(FusedEvaluation, MatchesDerivativeTrees)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto f = Tan(x / y) * Sqrt(y) - Ln(x) * Cbrt(y) + Tanh(x - y) + Cosh(x) / Sinh(y) + (x ^ y) + Pow(y, Constant<double, 3.0>{}) - -x;
+    double vars[] = {0.7, 1.3};
+    double grad[2], hess[4];
+    double value = evaluate_value_gradient_hessian<2>(f, vars, grad, hess);
+
+    auto dx = derivative<0>(f);
+    auto dy = derivative<1>(f);
+    EXPECT_NEAR(value, f(0.7, 1.3), 1e-12);
+    EXPECT_NEAR(grad[0], dx(0.7, 1.3), 1e-12);
+    EXPECT_NEAR(grad[1], dy(0.7, 1.3), 1e-12);
+    EXPECT_NEAR(hess[0], derivative<0>(dx)(0.7, 1.3), 1e-10);
+    EXPECT_NEAR(hess[1], derivative<1>(dx)(0.7, 1.3), 1e-10);
+    EXPECT_NEAR(hess[2], derivative<0>(dy)(0.7, 1.3), 1e-10);
+    EXPECT_NEAR(hess[3], derivative<1>(dy)(0.7, 1.3), 1e-10);
+}
+
+TEST(NewtonBracketed, Root)
+{
+    Variable<double, 0, 'x'> x;
+    auto f = x * x - Constant<double, 2.0>{};
+    auto r = newton_bracketed(f, 0.0, 2.0);
+    EXPECT_TRUE(r.converged);
+    EXPECT_NEAR(r.x, std::sqrt(2.0), 1e-10);
+}
+
+TEST(NewtonBracketed, FallsBackToBisection)
+{
+    Variable<double, 0, 'x'> x;
+    auto f = Cos(x) - x; // f'(-0.99) is close to 0 so the first newton step leaves the bracket
+    auto r = newton_bracketed(f, -1.0, 1.5, {-0.99});
+    EXPECT_TRUE(r.converged);
+    EXPECT_NEAR(r.x, 0.7390851332151607, 1e-10);
+
+    auto g = Tanh(x * Constant<double, 20.0>{});
+    auto s = newton_bracketed(g, -1.0, 3.0, {2.5});
+    EXPECT_TRUE(s.converged);
+    EXPECT_NEAR(s.x, 0.0, 1e-10);
+}
+
+TEST(NewtonBracketed, UsesGuess)
+{
+    Variable<double, 0, 'x'> x;
+    auto f = x * x - Constant<double, 2.0>{};
+    auto r = newton_bracketed(f, 0.0, 100.0, {std::sqrt(2.0)});
+    EXPECT_TRUE(r.converged);
+    EXPECT_EQ(r.iterations, 1u);
+    EXPECT_NEAR(r.x, std::sqrt(2.0), 1e-12);
+
+    auto midpoint = newton_bracketed(f, 0.0, 100.0);
+    EXPECT_GT(midpoint.iterations, 1u);
+}
+
+TEST(NewtonBracketed, OutOfIterations)
+{
+    Variable<double, 0, 'x'> x;
+    auto f = x * x - Constant<double, 2.0>{};
+    auto r = newton_bracketed(f, 0.0, 100.0, {}, {1e-12, 3});
+    EXPECT_FALSE(r.converged);
+    EXPECT_EQ(r.iterations, 3u);
+    EXPECT_DOUBLE_EQ(r.value, f(r.x)); // the value belongs to the returned point
+}
+
+TEST(NewtonBracketed, NotBracketed)
+{
+    Variable<double, 0, 'x'> x;
+    auto r = newton_bracketed(x * x + One<double>{}, -1.0, 1.0);
+    EXPECT_FALSE(r.converged);
+}
+
+TEST(NewtonBracketed, Batch)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'a'> a;
+    auto f = x * x * x - a; // cube root of a per lane
+    std::vector<double> as{1, 8, 27, 2, 1000, -5}, lo(6, 0.0), hi(6, 20.0), roots(6, 0.0);
+    roots[3] = 1.2599210498948732; // exact guess
+    bool converged[6];
+    const double *columns[] = {nullptr, as.data()};
+
+    std::size_t count = newton_bracketed_batch<2>(f, columns, lo.data(), hi.data(), roots.data(), converged, roots.size());
+    EXPECT_EQ(count, 5u);
+    for (std::size_t i = 0; i < 5; ++i)
+    {
+        EXPECT_TRUE(converged[i]);
+        EXPECT_NEAR(roots[i], std::cbrt(as[i]), 1e-9);
+    }
+    EXPECT_FALSE(converged[5]); // cbrt(-5) is not inside [0, 20]
+    EXPECT_EQ(roots[5], 0.0);   // and the guess is left alone
+}
+
+TEST(NewtonBracketed, BatchWorkspace)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'a'> a;
+    auto f = x * x * x - a;
+    newton_batch_workspace<double> workspace;
+    for (std::size_t n : {8u, 3u, 5u}) // grows, shrinks and grows again
+    {
+        std::vector<double> as(n), lo(n, 0.0), hi(n, 20.0), roots(n, 0.0);
+        for (std::size_t i = 0; i < n; ++i)
+            as[i] = static_cast<double>(i + 1);
+        bool converged[8];
+        const double *columns[] = {nullptr, as.data()};
+
+        std::size_t count = newton_bracketed_batch<2>(f, columns, lo.data(), hi.data(), roots.data(), converged, n, workspace);
+        EXPECT_EQ(count, n);
+        for (std::size_t i = 0; i < n; ++i)
+            EXPECT_NEAR(roots[i], std::cbrt(as[i]), 1e-9);
+    }
+}
+
+TEST(NewtonMinimize, Quadratic)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto f = (x - One<double>{}) * (x - One<double>{}) + Constant<double, 10.0>{} * (y + Constant<double, 2.0>{}) * (y + Constant<double, 2.0>{});
+    auto r = newton_minimize<2>(f, {5.0, 5.0});
+    EXPECT_TRUE(r.converged);
+    EXPECT_NEAR(r.x[0], 1.0, 1e-9);
+    EXPECT_NEAR(r.x[1], -2.0, 1e-9);
+    EXPECT_LE(r.iterations, 3u);
+}
+
+TEST(NewtonMinimize, Rosenbrock)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto a = One<double>{} - x;
+    auto b = y - x * x;
+    auto f = a * a + Constant<double, 100.0>{} * b * b; // needs backtracking, the accepted trials carry the next step
+    auto r = newton_minimize<2>(f, {-1.2, 1.0}, {1e-10, 200});
+    EXPECT_TRUE(r.converged);
+    EXPECT_NEAR(r.x[0], 1.0, 1e-8);
+    EXPECT_NEAR(r.x[1], 1.0, 1e-8);
+    EXPECT_DOUBLE_EQ(r.value, f(r.x[0], r.x[1]));
+}
+
+TEST(NewtonSystem, Circle)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto circle = x * x + y * y - Constant<double, 4.0>{}; // x² + y² = 4
+    auto line = x - y;                                     // x = y
+    auto r = newton_system(std::tuple{circle, line}, {1.0, 0.5});
+    EXPECT_TRUE(r.converged);
+    EXPECT_NEAR(r.x[0], std::sqrt(2.0), 1e-10);
+    EXPECT_NEAR(r.x[1], std::sqrt(2.0), 1e-10);
+}
+
+TEST(LBFGS, Rosenbrock)
+{
+    Variable<double, 0, 'x'> x;
+    Variable<double, 1, 'y'> y;
+    auto a = One<double>{} - x;
+    auto b = y - x * x;
+    auto f = a * a + Constant<double, 100.0>{} * b * b;
+    auto r = lbfgs_minimize<2>(f, {-1.2, 1.0}, {1e-8, 1000});
+    EXPECT_TRUE(r.converged);
+    EXPECT_NEAR(r.x[0], 1.0, 1e-6);
+    EXPECT_NEAR(r.x[1], 1.0, 1e-6);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}